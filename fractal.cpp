@@ -7,21 +7,42 @@
 #include<SDL2/SDL.h>
 #include<SDL2_image/SDL_image.h>
 #include<cmath>
+#include<sys/mman.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<time.h>
+#include<errno.h>
+#include "frame_ring.h"
 using namespace std;
 
 const int SCREEN_WIDTH = 1300;
 const int SCREEN_HEIGHT = 850;
 
+// frame scheduling
+const bool VSYNC = true;        // present in step with the display
+const int TARGET_FPS = 0;       // frame cap, 0 leaves it to vsync and the animation rate
+const int TICK_RATE = 600;      // timer ticks per second, the animation moves every 10 ticks
+const int IDLE_WAIT_MS = 1000;  // longest the loop sleeps waiting for input while paused
+
 
 bool init();
 bool loadMedia();
 void close();
 SDL_Texture* loadTexture(std::string path);
+bool open_frame_ring();
+void close_frame_ring();
 
 SDL_Window* gWindow = NULL;
 SDL_Renderer* gRenderer = NULL;
 SDL_Texture* gTexture = NULL;
 
+// shared memory frame ring, NULL unless FRACTAL_SHM is set
+FrameRing* gFrameRing = NULL;
+size_t gFrameRingSize = 0;
+std::string gFrameRingName;
+uint64_t gFrameCount = 0;
+bool gFrameReadFailed = false; // a failed readback has already been reported
+
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////// SDL FUNCTIONS ////////////////////////////////////////
@@ -46,7 +67,7 @@ bool init()
                 }
                 else {
                         // create renderer for window
-                        gRenderer = SDL_CreateRenderer(gWindow, -1, SDL_RENDERER_ACCELERATED );
+                        gRenderer = SDL_CreateRenderer(gWindow, -1, SDL_RENDERER_ACCELERATED | (VSYNC ? SDL_RENDERER_PRESENTVSYNC : 0) );
                         if (gRenderer == NULL) {
                                 cout << "renderer couldn't be created";
                                 success = false;
@@ -87,6 +108,7 @@ void close()
         gWindow = NULL;
         gRenderer = NULL;
         
+        close_frame_ring();
 
         IMG_Quit();
         SDL_Quit();
@@ -111,6 +133,77 @@ SDL_Texture* loadTexture(std::string path)
         return newTexture;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////// FRAME RING ///////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// creates the shared memory frame ring (layout in frame_ring.h) if the
+// FRACTAL_SHM environment variable names one, e.g. FRACTAL_SHM=/fractal_frames
+// returns false only if publishing was asked for and couldn't be set up
+bool open_frame_ring()
+{
+        char *name = getenv("FRACTAL_SHM");
+        if (name == NULL) {
+                return true;
+        }
+        gFrameRingName = (name[0] != '\0') ? name : FRAME_RING_DEFAULT_NAME;
+        gFrameRingSize = frame_ring_size(SCREEN_WIDTH, SCREEN_HEIGHT, FRAME_RING_SLOTS);
+
+        // O_EXCL so two producers never share (and later unlink) one ring
+        int fd = shm_open(gFrameRingName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 && errno == EEXIST) {
+                cout << "shared memory " << gFrameRingName << " is already in use, "
+                     << "pick another FRACTAL_SHM or remove it if no fractal is running" << endl;
+                return false;
+        }
+        if (fd < 0) {
+                cout << "couldn't open shared memory " << gFrameRingName;
+                return false;
+        }
+        if (ftruncate(fd, gFrameRingSize) < 0) {
+                cout << "couldn't size shared memory";
+                close(fd);
+                shm_unlink(gFrameRingName.c_str());
+                return false;
+        }
+        void *mem = mmap(NULL, gFrameRingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd); // the mapping stays valid after the descriptor is closed
+        if (mem == MAP_FAILED) {
+                cout << "couldn't map shared memory";
+                shm_unlink(gFrameRingName.c_str());
+                return false;
+        }
+
+        // fill in the header, magic goes last so consumers never see a half built ring
+        gFrameRing = (FrameRing*)mem;
+        gFrameRing->magic.store(0, std::memory_order_relaxed);
+        gFrameRing->version = FRAME_RING_VERSION;
+        gFrameRing->width = SCREEN_WIDTH;
+        gFrameRing->height = SCREEN_HEIGHT;
+        gFrameRing->slots = FRAME_RING_SLOTS;
+        gFrameRing->slot_size = frame_slot_size(SCREEN_WIDTH, SCREEN_HEIGHT);
+        gFrameRing->head.store(0, std::memory_order_relaxed);
+        for (int i = 0; i < FRAME_RING_SLOTS; i++)
+        {
+                frame_ring_slot(gFrameRing, i)->seq.store(0, std::memory_order_relaxed);
+        }
+        gFrameRing->magic.store(FRAME_RING_MAGIC, std::memory_order_release);
+        gFrameCount = 0;
+        return true;
+}
+
+// unmaps and removes the frame ring, consumers still mapped keep their view
+void close_frame_ring()
+{
+        if (gFrameRing == NULL) {
+                return;
+        }
+        gFrameRing->magic.store(0, std::memory_order_release);
+        munmap(gFrameRing, gFrameRingSize);
+        shm_unlink(gFrameRingName.c_str());
+        gFrameRing = NULL;
+}
+
 static int rand_seed = -1;
 void seed_random(int s)
 {
@@ -309,6 +402,21 @@ unsigned short Line::get_alpha()
 // 
 // (each angle is 60 degrees)
 //
+// every iteration that has been computed is kept as a level of a pyramid,
+// level k holding the 4^k lines of k iterations. Changing the number of
+// iterations picks an existing level, or subdivides the highest level below
+// it, instead of starting over from a single line. The levels are thrown
+// away when something that changes the shape (angle, length, position...) is set.
+//
+// note: the lines are stored in screen coordinates, so this only saves work
+// while the shape holds still (paused, or between animation steps). The
+// animation in main changes the angle, length, position and angle_const
+// every step, so each step still rebuilds from level 0, the same as before.
+// Storing the levels relative to the curve wouldn't help there either,
+// since the animated angle_const changes every level.
+//
+const int KOCH_MAX_LEVELS = 8; // deepest level, 4^8 lines
+
 class Koch {
         public:
                 // constructor and destructor
@@ -326,7 +434,8 @@ class Koch {
                 //
                 Koch(float l, float a, int xpos, int ypos, Color col, int iterations, float a_const);
                 
-                // recursively repeats line replacement n number of times
+                // recursively repeats line replacement n number of times,
+                // starting from the current level, returns the new level
                 int recursion(int n);
 
                 // prints the fractal
@@ -340,6 +449,7 @@ class Koch {
                 void set_iterations(int n);
                 void set_pi(float p);
                 void set_color(Color col);
+                void set_cache_levels(int n);
                 
                 // getters
                 float get_angle();
@@ -350,10 +460,11 @@ class Koch {
                 int get_y();
                 int get_iterations();
                 Color get_color();
+                int get_cache_levels();
                 
                 // reinitializes private variables,
-                // deletes entire array of lines, in order to 
-                // produce a new array
+                // rebuilds the pyramid of levels if the shape changed, then
+                // selects the level for the current number of iterations
                 // (used if variables change in main loop, animation)
                 void reinitialize();
 
@@ -368,15 +479,30 @@ class Koch {
                 int iterations;
                 float pi; // initialized to M_PI but can be changed (it's fun)
 
-                // function splits each line into four new lines,
-                // updates array of lines by deleting old lines and
-                // replacing with four new smaller lines
+                // function splits each line of a level into four new lines,
+                // storing the smaller lines as the next level up
                 // (as shown in Koch curve figure)
-                void make_four();
+                void make_four(int level);
+
+                // deletes every level
+                void clear_levels();
+
+                // makes a level the one that gets printed
+                void use_level(int n);
 
-                // dynamic array of lines
+                // deletes the lowest levels until no more than cache_levels
+                // subdivided levels are left (the current level always stays)
+                void trim_levels();
+
+                // pyramid of levels, NULL where a level isn't kept
+                Line *levels[KOCH_MAX_LEVELS + 1];
+                int level_num[KOCH_MAX_LEVELS + 1];
+                int cache_levels; // KOCH_MAX_LEVELS keeps every level
+                bool dirty; // shape changed since the levels were built
+
+                // current level, the lines that get printed
+                int level;
                 Line *lines;
-                int cap;
                 int num;
 
 };
@@ -394,16 +520,20 @@ Koch::Koch(float l, float a, int xpos, int ypos, Color col, int its, float a_con
         y = ypos;
         color = col;
         angle_const = a_const;
-        Line initial(angle, length, x, y, color);
-        // make first node with line
-        
-        cap = 10;
-        num = 0;
-        lines = new Line[cap];
-        lines[num] = initial;
-        num++;
         iterations = its;
-        recursion(iterations);
+
+        // empty pyramid, keeps every level until told otherwise
+        for (int i = 0; i <= KOCH_MAX_LEVELS; i++)
+        {
+                levels[i] = NULL;
+                level_num[i] = 0;
+        }
+        cache_levels = KOCH_MAX_LEVELS;
+        dirty = true;
+        level = 0;
+        lines = NULL;
+        num = 0;
+        reinitialize();
 }
 
 // destructor
@@ -412,28 +542,33 @@ Koch::~Koch()
 //        delete []lines;
 }
 
-// recursively makes four lines out of one line, n iterations
+// recursively makes four lines out of one line, n iterations,
+// reusing any level that's already in the pyramid
 int Koch::recursion(int n)
 {
         
-        if (n == 0) {return n;}
+        if (n == 0 || level == KOCH_MAX_LEVELS) {return level;}
         
-        make_four();
+        if (levels[level + 1] == NULL) {make_four(level);}
+        use_level(level + 1);
 
-        recursion(n - 1);
+        return recursion(n - 1);
 
 }
 
-void Koch::make_four()
+void Koch::make_four(int lvl)
 {
-        // temporary new array of lines, capacity four times as big (4x as many lines will be generated)
-        Line *lines2 = new Line[cap*4];
+        Line *old_lines = levels[lvl];
+        int old_num = level_num[lvl];
+
+        // new level, four times as big (4x as many lines will be generated)
+        Line *lines2 = new Line[old_num*4];
         
         int num2 = 0;  // number of Lines used in new array
 
-        for (int i = 0; i < num; i++) // loop through old array
+        for (int i = 0; i < old_num; i++) // loop through old array
         {
-                Line cline = lines[i]; // for each line
+                Line cline = old_lines[i]; // for each line
                 
                 //////////////////////////////////////////////////////////////////////////////////////////////////
                 ///// generate four lines based on the line given, these lines are each geometrically defined   
@@ -444,7 +579,7 @@ void Koch::make_four()
                 int x2 = cline.get_x() + ((cline.get_length()/4) * cos(cline.get_angle() * pi/180));            
                 int y2 = cline.get_y() + ((cline.get_length()/4) * sin(cline.get_angle() * pi/180));            
                 Line temp2(cline.get_angle() + angle_const, cline.get_length()/4, x2, y2, color);               
-                if (i >= num/2)                                                                                 
+                if (i >= old_num/2)                                                                             
                 {                                                                                               
                         temp2.set_angle(cline.get_angle() - angle_const);                                       
                 }                                                                                               
@@ -452,7 +587,7 @@ void Koch::make_four()
                 int x3 = cline.get_x() + (2*(cline.get_length()/4) * cos(cline.get_angle() * pi/180));          
                 int y3 = cline.get_y() + (2*(cline.get_length()/4) * sin(cline.get_angle() * pi/180));          
                 Line temp3(cline.get_angle() + (2*angle_const), cline.get_length()/4,  x3, y3, color);          
-                if (i >= num/2)                                                                                 
+                if (i >= old_num/2)                                                                             
                 {                                                                                               
                         temp3.set_angle(cline.get_angle() - (2*angle_const));                                   
                 }                                                                                               
@@ -468,10 +603,47 @@ void Koch::make_four()
                 lines2[num2+3] = temp4;
                 num2 += 4; // update count
         }
-        delete []lines; // delete old lines
-        num = num2; // update number of lines
-        lines = lines2; // reassign array pointer
-        cap = cap*4; // update capacity
+        levels[lvl + 1] = lines2; // old level stays in the pyramid
+        level_num[lvl + 1] = num2;
+}
+
+// deletes every level of the pyramid
+void Koch::clear_levels()
+{
+        for (int i = 0; i <= KOCH_MAX_LEVELS; i++)
+        {
+                delete []levels[i];
+                levels[i] = NULL;
+                level_num[i] = 0;
+        }
+}
+
+// points the printed lines at a level
+void Koch::use_level(int n)
+{
+        level = n;
+        lines = levels[n];
+        num = level_num[n];
+}
+
+// drops the lowest subdivided levels first, they are the cheapest to make again
+void Koch::trim_levels()
+{
+        int kept = 0;
+        for (int i = 1; i <= KOCH_MAX_LEVELS; i++)
+        {
+                if (levels[i] != NULL && i != level) {kept++;}
+        }
+        for (int i = 1; i <= KOCH_MAX_LEVELS && kept > cache_levels; i++)
+        {
+                if (levels[i] != NULL && i != level)
+                {
+                        delete []levels[i];
+                        levels[i] = NULL;
+                        level_num[i] = 0;
+                        kept--;
+                }
+        }
 }
 
 // prints line by drawing each line
@@ -483,36 +655,54 @@ void Koch::print()
         } 
 }
 
-// deletes array of lines in order to create a new
-// array in animation
+// rebuilds the pyramid from a single line if the shape changed, then
+// selects the level for the number of iterations (used in animation)
 void Koch::reinitialize()
 {
-        delete []lines;
-        Line initial(angle, length, x, y, color);
-        
-        cap = 10;
-        num = 0;
-        lines = new Line[cap];
-        lines[num] = initial;
-        num++;
-        recursion(iterations);
+        if (dirty)
+        {
+                clear_levels();
+                Line initial(angle, length, x, y, color);
+                levels[0] = new Line[1];
+                levels[0][0] = initial;
+                level_num[0] = 1;
+                dirty = false;
+        }
+
+        int n = iterations;
+        if (n < 0) {n = 0;}
+        if (n > KOCH_MAX_LEVELS) {n = KOCH_MAX_LEVELS;}
+
+        // start from the highest level already made at or below n,
+        // only the levels above it get subdivided
+        int start = n;
+        while (levels[start] == NULL) {start--;}
+        use_level(start);
+        recursion(n - start);
+        trim_levels();
 }
 
 //////////////////////// setters /////////////////////////
+// (anything that changes the shape marks the levels as out of date,
+//  iterations don't since they only pick a level)
 void Koch::set_angle(float a)
 {
+        if (a != angle) {dirty = true;}
         angle = a;
 }
 void Koch::set_length(float l)
 {
+        if (l != length) {dirty = true;}
         length = l;
 }
 void Koch::set_angle_const(float a)
 {
+        if ((int)a != angle_const) {dirty = true;}
         angle_const = a;
 }
 void Koch::set_position(int xx, int yy)
 {
+        if (xx != x || yy != y) {dirty = true;}
         x = xx;
         y = yy;
 }
@@ -522,12 +712,22 @@ void Koch::set_iterations(int n)
 }
 void Koch::set_pi(float p)
 {
+        if (p != pi) {dirty = true;}
         pi = p;
 } 
 void Koch::set_color(Color col)
 {
+        if (col.r != color.r || col.g != color.g || col.b != color.b || col.a != color.a) {dirty = true;}
         color = col;
 }
+// number of subdivided levels kept besides the base and the current one,
+// KOCH_MAX_LEVELS keeps all of them
+void Koch::set_cache_levels(int n)
+{
+        if (n < 0) {n = 0;}
+        cache_levels = n;
+        trim_levels();
+}
 
 
 //////////////////////// getters /////////////////////////
@@ -563,6 +763,62 @@ Color Koch:: get_color()
 {
         return color;
 }
+int Koch::get_cache_levels()
+{
+        return cache_levels;
+}
+
+// copies the frame that was just drawn into the next slot of the frame ring,
+// along with the timer and the parameters of each curve
+// (must be called before SDL_RenderPresent, the back buffer is undefined after)
+void publish_frame(int timer, Koch koch[], int n)
+{
+        if (gFrameRing == NULL) {
+                return;
+        }
+        uint64_t frame = gFrameCount + 1;
+        FrameSlot *slot = frame_ring_slot(gFrameRing, (frame - 1) % gFrameRing->slots);
+
+        // odd sequence marks the slot as being written
+        slot->seq.store(2*frame - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        // the renderer reads the back buffer straight into shared memory,
+        // never more than the slot holds even if the window came out bigger
+        SDL_Rect r = {0, 0, (int)gFrameRing->width, (int)gFrameRing->height};
+        if (SDL_RenderReadPixels(gRenderer, &r, SDL_PIXELFORMAT_RGBA32, frame_slot_pixels(slot), gFrameRing->width * 4) != 0) {
+                if (!gFrameReadFailed) {
+                        cout << "couldn't read pixels: " << SDL_GetError() << endl;
+                        gFrameReadFailed = true;
+                }
+                // the slot stays odd (sequences never go back), so consumers
+                // drop whatever was in it; the next frame reuses the same number
+                return;
+        }
+
+        if (n > FRAME_RING_CURVES) {n = FRAME_RING_CURVES;}
+        for (int i = 0; i < n; i++)
+        {
+                slot->curves[i].length = koch[i].get_length();
+                slot->curves[i].angle = koch[i].get_angle();
+                slot->curves[i].angle_const = koch[i].get_angle_const();
+                slot->curves[i].x = koch[i].get_x();
+                slot->curves[i].y = koch[i].get_y();
+                slot->curves[i].iterations = koch[i].get_iterations();
+        }
+        slot->num_curves = n;
+        slot->timer = timer;
+        slot->frame = frame;
+
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        slot->publish_ns = (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+
+        // even sequence publishes the slot, then the head points consumers at it
+        slot->seq.store(2*frame, std::memory_order_release);
+        gFrameRing->head.store(frame, std::memory_order_release);
+        gFrameCount = frame;
+}
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////// MAIN IMPLEMENTATION //////////////////////////////////
@@ -578,6 +834,10 @@ int main( int argc, char* args[])
                         cout << "failed to load media";
                 }               
                 else {
+                        // publish frames to shared memory if asked for
+                        if (!open_frame_ring()) {
+                                cout << "frames won't be published";
+                        }
 
                         bool quit = false;
                         SDL_Event e;
@@ -592,6 +852,7 @@ int main( int argc, char* args[])
                         bool grow = true;
                         int RATE = 4;
                         bool color_increment = false;
+                        int CACHE_LEVELS = KOCH_MAX_LEVELS; // subdivided levels each curve keeps (memory vs. rebuilding)
                         ///////////// CONTENTS ///////////////////////
                         
                         Color c_koch = {50, 130, 20, 255};
@@ -609,22 +870,62 @@ int main( int argc, char* args[])
                         koch[0] = koch0; koch[1] = koch1; koch[2] = koch2;
                         koch[3] = koch3; koch[4] = koch4; koch[5] = koch5;
                         koch[6] = koch6; koch[7] = koch7;
+                        for (int i = 0; i < 8; i++)
+                        {
+                                koch[i].set_cache_levels(CACHE_LEVELS);
+                        }
 
                         ///////////// TIMER //////////////////////////
                         int timer = 0;
                         
+                        // the timer runs on a fixed clock of TICK_RATE ticks a second,
+                        // so the animation moves at the same speed on any machine,
+                        // frames are only drawn when something changed
+                        bool paused = false;
+                        bool redraw = true;
+                        bool rebuild = false; // the animation moved the curves since they were last built
+                        Uint64 freq = SDL_GetPerformanceFrequency();
+                        Uint64 tick_len = freq / TICK_RATE;
+                        Uint64 frame_len = (TARGET_FPS > 0) ? freq / TARGET_FPS : 0;
+                        Uint64 max_lag = freq / 4; // don't try to catch up on more than a quarter second
+                        Uint64 last_time = SDL_GetPerformanceCounter();
+                        Uint64 next_frame = last_time;
+                        Uint64 lag = 0;
 
                         ///////////// RUN LOOP ///////////////////////
                         while (!quit)
                         {
-                                SDL_RenderCopy( gRenderer, gTexture, NULL, NULL);
-                                
+                                ///////////// SCHEDULE ////////////////////////
+
+                                // sleep until input arrives when paused, otherwise until
+                                // the next animation step (and the next frame if capped)
+                                Uint64 now = SDL_GetPerformanceCounter();
+                                int wait_ms = 0;
+                                if (paused && !redraw) {
+                                        wait_ms = IDLE_WAIT_MS;
+                                }
+                                else {
+                                        Uint64 wake = now;
+                                        if (!redraw) {
+                                                // lag was measured at last_time, so count from there
+                                                // (drawing and a vsync'd present have eaten into the wait)
+                                                Uint64 need = (((10 - timer % 10) % 10) + 1) * tick_len;
+                                                if (need > lag && last_time + (need - lag) > now) {wake = last_time + (need - lag);}
+                                        }
+                                        if (next_frame > wake) {wake = next_frame;}
+                                        wait_ms = (int)(((wake - now) * 1000 + freq - 1) / freq);
+                                }
+
                                 // manages interface events through SDL
-                                while (SDL_PollEvent(&e) != 0)
+                                int got_event = (wait_ms > 0) ? SDL_WaitEventTimeout(&e, wait_ms) : SDL_PollEvent(&e);
+                                while (got_event != 0)
                                 {
                                         if (e.type == SDL_QUIT){
                                                 quit = true;
                                         }
+                                        else if (e.type == SDL_WINDOWEVENT) {
+                                                redraw = true; // window was uncovered, resized, etc.
+                                        }
                                         else if ( e.type == SDL_KEYDOWN ) 
                                         {
                                                 switch(e.key.keysym.sym)
@@ -635,66 +936,129 @@ int main( int argc, char* args[])
                                                         case SDLK_LEFT:
                                                                 break;
 
+                                                        // change the depth, reuses kept levels if the shape hasn't
+                                                        // changed since the last rebuild (i.e. while paused)
                                                         case SDLK_UP:
+                                                                for (int i = 0; i < 8; i++)
+                                                                {
+                                                                        if (koch[i].get_iterations() < KOCH_MAX_LEVELS) {
+                                                                                koch[i].set_iterations(koch[i].get_iterations() + 1);
+                                                                        }
+                                                                        koch[i].reinitialize();
+                                                                }
+                                                                redraw = true;
                                                                 break;
 
                                                         case SDLK_DOWN:
+                                                                for (int i = 0; i < 8; i++)
+                                                                {
+                                                                        if (koch[i].get_iterations() > 0) {
+                                                                                koch[i].set_iterations(koch[i].get_iterations() - 1);
+                                                                        }
+                                                                        koch[i].reinitialize();
+                                                                }
+                                                                redraw = true;
+                                                                break;
+
+                                                        // stops and starts the animation
+                                                        case SDLK_SPACE:
+                                                                paused = !paused;
                                                                 break;
 
                                                 }
                                         }
+                                        got_event = SDL_PollEvent(&e);
+                                }
+
+                                // run the timer ticks that are due
+                                now = SDL_GetPerformanceCounter();
+                                if (!paused) {
+                                        lag += now - last_time;
+                                        if (lag > max_lag) {lag = max_lag;}
                                 }
+                                last_time = now;
 
 
                                 ///////////// OBJECT RENDER ///////////////////
                                 
-                                if (timer % 10 == 0) // rate of animation 
+                                while (lag >= tick_len)
                                 {
-                                        // boolean motion right or left
-                                        if (koch[0].get_x() > SCREEN_WIDTH - LENGTH) {right = !right;}
-                                        if (koch[0].get_x() < LENGTH) {right = !right;}
+                                        lag -= tick_len;
+                                        if (timer % 10 == 0) // rate of animation 
+                                        {
+                                                // boolean motion right or left
+                                                if (koch[0].get_x() > SCREEN_WIDTH - LENGTH) {right = !right;}
+                                                if (koch[0].get_x() < LENGTH) {right = !right;}
                                         
-                                        // boolean grow or shrink
-                                        if ((int)koch[0].get_length() > LARGE) {grow = !grow;}
-                                        if ((int)koch[0].get_length() < SMALL) {grow = !grow;}
+                                                // boolean grow or shrink
+                                                if ((int)koch[0].get_length() > LARGE) {grow = !grow;}
+                                                if ((int)koch[0].get_length() < SMALL) {grow = !grow;}
                                         
-                                        // 
-                                        for (int i = 0; i < 8; i++) 
-                                        {
-                                                if (timer % 1500 == 0 && timer > 100)
+                                                // 
+                                                for (int i = 0; i < 8; i++) 
                                                 {
-                                                        if (koch[i].get_iterations() > 4) {
-                                                                koch[i].set_iterations(0);
+                                                        if (timer % 1500 == 0 && timer > 100)
+                                                        {
+                                                                if (koch[i].get_iterations() > 4) {
+                                                                        koch[i].set_iterations(0);
+                                                                }
+                                                                koch[i].set_iterations(koch[i].get_iterations() + 1);
                                                         }
-                                                        koch[i].set_iterations(koch[i].get_iterations() + 1);
-                                                }
 
-                                                // implements the boolean values
-                                                if (grow) {koch[i].set_length(koch[i].get_length() + GROWTH);}
-                                                if (!grow) {koch[i].set_length(koch[i].get_length() - GROWTH);}
-                                                if (right){koch[i].set_position(koch[i].get_x()+1, koch[i].get_y());}
-                                                if (!right){koch[i].set_position(koch[i].get_x()-1, koch[i].get_y());}
+                                                        // implements the boolean values
+                                                        if (grow) {koch[i].set_length(koch[i].get_length() + GROWTH);}
+                                                        if (!grow) {koch[i].set_length(koch[i].get_length() - GROWTH);}
+                                                        if (right){koch[i].set_position(koch[i].get_x()+1, koch[i].get_y());}
+                                                        if (!right){koch[i].set_position(koch[i].get_x()-1, koch[i].get_y());}
                                                
-                                                // rotates
-                                                koch[i].set_angle(koch[i].get_angle() + 1);
-                                                koch[i].set_angle_const(koch[i].get_angle_const() + 1);
-                                                koch[i].reinitialize();
-                                                koch[i].set_pi(RATE); // if pi is increased, the rate of spinning increases (idk why)
+                                                        // rotates
+                                                        koch[i].set_angle(koch[i].get_angle() + 1);
+                                                        koch[i].set_angle_const(koch[i].get_angle_const() + 1);
+                                                }
+                                                rebuild = true; // lines are rebuilt once, right before drawing
+                                                redraw = true;
                                         }
-                                } 
 
-                                // print all the lines
-                                for (int i = 0; i < 8; i++)
-                                {
-                                        koch[i].print();
+                                        // increment the timer
+                                        timer++;
+                                        if (timer > 30000) {timer = 0;} // resets timer
                                 }
 
-                                // update the SDL screen
-                                SDL_RenderPresent( gRenderer );
+                                // draw only if something changed and a frame is due
+                                if (redraw && now >= next_frame)
+                                {
+                                        // rebuild the lines once, however many steps were caught up on
+                                        // (set_pi still comes after reinitialize, like it did per step)
+                                        if (rebuild)
+                                        {
+                                                for (int i = 0; i < 8; i++)
+                                                {
+                                                        koch[i].reinitialize();
+                                                        koch[i].set_pi(RATE); // if pi is increased, the rate of spinning increases (idk why)
+                                                }
+                                                rebuild = false;
+                                        }
+
+                                        SDL_RenderCopy( gRenderer, gTexture, NULL, NULL);
+
+                                        // print all the lines
+                                        for (int i = 0; i < 8; i++)
+                                        {
+                                                koch[i].print();
+                                        }
+
+                                        // hand the finished frame to other processes
+                                        publish_frame(timer, koch, 8);
 
-                                // increment the timer
-                                timer++;
-                                if (timer > 30000) {timer = 0;} // resets timer
+                                        // update the SDL screen (waits for the display if VSYNC is on)
+                                        SDL_RenderPresent( gRenderer );
+                                        redraw = false;
+
+                                        // keep to the frame cap, unless we fell a whole frame behind
+                                        if (frame_len > 0) {
+                                                next_frame = (now - next_frame < frame_len) ? next_frame + frame_len : now + frame_len;
+                                        }
+                                }
                         }
                 }
         }
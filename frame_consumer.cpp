@@ -0,0 +1,203 @@
+// Frame Consumer
+//
+// By: Ari Brown
+//
+// Reference consumer for the shared memory frame ring that fractal publishes
+// to (see frame_ring.h). Maps the ring read only and reads every frame in
+// place, without copying the pixels out. Checks that frames arrive in order,
+// counts frames that were dropped or overwritten while being read, and
+// measures the latency between the renderer finishing a frame and this
+// process seeing it.
+//
+// Usage:
+//      FRACTAL_SHM=/fractal_frames ./fractal
+//      ./frame_consumer [name] [frames]
+//
+#include<iostream>
+#include<stdlib.h>
+#include<stdint.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<time.h>
+#include "frame_ring.h"
+using namespace std;
+
+// current CLOCK_MONOTONIC time, same clock the producer stamps frames with
+uint64_t now_ns()
+{
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// sleeps for a number of microseconds
+void nap(long us)
+{
+        timespec t = {0, us * 1000};
+        nanosleep(&t, NULL);
+}
+
+// running statistics, printed once a second
+struct Stats {
+        uint64_t read;          // frames read intact
+        uint64_t dropped;       // frames overwritten before they were read
+        uint64_t torn;          // frames overwritten while being read
+        uint64_t out_of_order;  // frames older than one already read
+        uint64_t lat_min;
+        uint64_t lat_max;
+        uint64_t lat_total;
+};
+
+void reset_latency(Stats &s)
+{
+        s.lat_min = UINT64_MAX;
+        s.lat_max = 0;
+        s.lat_total = 0;
+}
+
+void print_stats(Stats &s, uint64_t interval_reads)
+{
+        cout << "read " << s.read << "  dropped " << s.dropped << "  torn " << s.torn
+             << "  out of order " << s.out_of_order;
+        if (interval_reads > 0) {
+                cout << "  latency us min " << s.lat_min / 1000
+                     << " avg " << s.lat_total / interval_reads / 1000
+                     << " max " << s.lat_max / 1000;
+        }
+        cout << endl;
+}
+
+// waits for the producer and maps the ring, returns NULL on failure
+FrameRing* map_ring(const char *name, size_t &size)
+{
+        int fd = -1;
+        while ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+                nap(100000); // producer isn't up yet
+        }
+
+        // the size of the object tells us how much to map
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(FrameRing)) {
+                cout << "shared memory " << name << " is too small" << endl;
+                close(fd);
+                return NULL;
+        }
+        size = st.st_size;
+        FrameRing *ring = (FrameRing*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (ring == MAP_FAILED) {
+                cout << "couldn't map shared memory" << endl;
+                return NULL;
+        }
+
+        // wait until the producer has finished filling in the header
+        while (ring->magic.load(std::memory_order_acquire) != FRAME_RING_MAGIC) {
+                nap(1000);
+        }
+        // the header can't be trusted, check everything the slot math depends on
+        if (ring->version != FRAME_RING_VERSION ||
+            ring->slots == 0 || ring->width == 0 || ring->height == 0 ||
+            ring->slot_size != frame_slot_size(ring->width, ring->height) ||
+            frame_ring_size(ring->width, ring->height, ring->slots) > size) {
+                cout << "frame ring doesn't match this consumer" << endl;
+                munmap(ring, size);
+                return NULL;
+        }
+        return ring;
+}
+
+int main(int argc, char* args[])
+{
+        const char *name = (argc > 1) ? args[1] : FRAME_RING_DEFAULT_NAME;
+        uint64_t limit = (argc > 2) ? strtoull(args[2], NULL, 10) : 0; // 0 runs until the producer quits
+
+        size_t size = 0;
+        FrameRing *ring = map_ring(name, size);
+        if (ring == NULL) {
+                return 1;
+        }
+        cout << "reading " << ring->width << "x" << ring->height << " frames from " << name << endl;
+
+        Stats s = {0, 0, 0, 0, 0, 0, 0};
+        reset_latency(s);
+        uint64_t interval_reads = 0;
+        uint64_t last = ring->head.load(std::memory_order_acquire); // start at the newest frame
+        uint64_t last_print = now_ns();
+        uint32_t checksum = 0;
+
+        while (ring->magic.load(std::memory_order_acquire) == FRAME_RING_MAGIC && (limit == 0 || s.read < limit))
+        {
+                uint64_t head = ring->head.load(std::memory_order_acquire);
+                if (head < last) {
+                        s.out_of_order++; // producer went backwards
+                        last = head;
+                        continue;
+                }
+                if (head == last) {
+                        nap(200);
+                        continue;
+                }
+
+                // anything that has already been lapped by the producer is gone
+                uint64_t oldest = (head > ring->slots) ? head - ring->slots + 1 : 1;
+                if (last + 1 < oldest) {
+                        s.dropped += oldest - (last + 1);
+                        last = oldest - 1;
+                }
+
+                for (uint64_t frame = last + 1; frame <= head; frame++)
+                {
+                        FrameSlot *slot = frame_ring_slot(ring, (frame - 1) % ring->slots);
+                        uint64_t seq = slot->seq.load(std::memory_order_acquire);
+                        if (seq != 2*frame) {
+                                s.dropped++; // already reused for a newer frame
+                                continue;
+                        }
+                        uint64_t latency = now_ns() - slot->publish_ns;
+
+                        // read the frame in place, a real consumer would composite it here
+                        uint64_t number = slot->frame;
+                        const unsigned char *pixels = frame_slot_pixels(slot);
+                        size_t bytes = (size_t)ring->width * ring->height * 4;
+                        uint32_t sum = 0;
+                        for (size_t i = 0; i < bytes; i += 64)
+                        {
+                                sum += pixels[i];
+                        }
+
+                        // if the sequence moved the producer wrote over us mid read
+                        std::atomic_thread_fence(std::memory_order_acquire);
+                        if (slot->seq.load(std::memory_order_relaxed) != seq) {
+                                s.torn++;
+                                continue;
+                        }
+                        if (number != frame) {
+                                s.out_of_order++;
+                                continue;
+                        }
+
+                        checksum += sum;
+                        s.read++;
+                        interval_reads++;
+                        s.lat_total += latency;
+                        if (latency < s.lat_min) {s.lat_min = latency;}
+                        if (latency > s.lat_max) {s.lat_max = latency;}
+                }
+                last = head;
+
+                // report once a second
+                if (now_ns() - last_print >= 1000000000ull) {
+                        print_stats(s, interval_reads);
+                        reset_latency(s);
+                        interval_reads = 0;
+                        last_print = now_ns();
+                }
+        }
+        print_stats(s, interval_reads);
+        cout << "checksum " << checksum << endl;
+
+        munmap(ring, size);
+        return (s.out_of_order == 0) ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+// Frame Ring
+//
+// By: Ari Brown
+//
+// Layout of the POSIX shared-memory ring that the fractal renderer publishes
+// finished frames into. Shared by fractal.cpp (the producer) and
+// frame_consumer.cpp (the reference consumer), so both sides agree on it.
+//
+//   [ FrameRing header ][ slot 0 ][ slot 1 ] ... [ slot FRAME_RING_SLOTS-1 ]
+//
+// each slot is a FrameSlot header followed by width*height RGBA pixels.
+//
+// Frame n (counting from 1) is written to slot (n-1) % FRAME_RING_SLOTS.
+// Every slot carries its own sequence counter, used as a seqlock:
+//
+//      odd  (2n-1) -> the producer is writing frame n into the slot
+//                     (or failed to, the slot stays odd until frame n is retried)
+//      even (2n)   -> frame n is complete and can be read
+//
+// the sequence of a slot only ever goes up.
+//
+// There are no locks: a consumer reads the slot's sequence, reads the frame
+// straight out of the mapping, then reads the sequence again. If it changed,
+// the producer lapped the consumer and the frame has to be thrown away.
+//
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include<atomic>
+#include<stddef.h>
+#include<stdint.h>
+
+// the atomics below are shared between processes (and mapped read only by
+// consumers), which only works if they are lock free and don't hide a lock
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "frame ring needs always lock free 32 and 64 bit atomics");
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t) &&
+              sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "frame ring atomics must have the same layout as plain integers");
+
+const char FRAME_RING_DEFAULT_NAME[] = "/fractal_frames";
+const uint32_t FRAME_RING_MAGIC = 0x4b4f4348; // "KOCH"
+const uint32_t FRAME_RING_VERSION = 1;
+const int FRAME_RING_SLOTS = 4;
+const int FRAME_RING_CURVES = 8;
+
+// parameters of one koch curve at the time the frame was drawn
+struct FrameCurve {
+        float length;
+        float angle;
+        float angle_const;
+        int32_t x;
+        int32_t y;
+        int32_t iterations;
+};
+
+// per frame header, pixels follow directly after it
+struct FrameSlot {
+        std::atomic<uint64_t> seq;      // seqlock counter (see above)
+        uint64_t frame;                 // frame number, starts at 1
+        uint64_t publish_ns;            // CLOCK_MONOTONIC time the frame was finished
+        int32_t timer;                  // main loop timer tick
+        int32_t num_curves;
+        FrameCurve curves[FRAME_RING_CURVES];
+};
+
+// header at the start of the shared memory object
+struct FrameRing {
+        std::atomic<uint32_t> magic;    // FRAME_RING_MAGIC once the header is filled in, 0 after the producer quits
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t slots;
+        uint32_t slot_size;             // bytes per slot, header and pixels
+        std::atomic<uint64_t> head;     // number of the newest complete frame
+};
+
+// size of one slot, rounded up so every slot header stays 64 byte aligned
+inline size_t frame_slot_size(uint32_t width, uint32_t height)
+{
+        size_t size = sizeof(FrameSlot) + (size_t)width * height * 4;
+        return (size + 63) & ~(size_t)63;
+}
+
+// total size of the shared memory object
+inline size_t frame_ring_size(uint32_t width, uint32_t height, uint32_t slots)
+{
+        size_t header = (sizeof(FrameRing) + 63) & ~(size_t)63;
+        return header + frame_slot_size(width, height) * slots;
+}
+
+// returns slot i of a mapped ring
+inline FrameSlot* frame_ring_slot(FrameRing *ring, uint32_t i)
+{
+        size_t header = (sizeof(FrameRing) + 63) & ~(size_t)63;
+        return (FrameSlot*)((char*)ring + header + (size_t)ring->slot_size * i);
+}
+
+// returns the RGBA pixels of a slot
+inline unsigned char* frame_slot_pixels(FrameSlot *slot)
+{
+        return (unsigned char*)slot + sizeof(FrameSlot);
+}
+
+#endif